@@ -20,16 +20,43 @@
 #ifndef _BLE_SVC_BATTERY_H_
 #define _BLE_SVC_BATTERY_H_
 
+#include "host/ble_gatt.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define BLE_SVC_BATTERY_UUID16                                  0x180F
 #define BLE_SVC_BATTERY_CHR_LEVEL_UUID16                        0x2A19
+/* Vendor characteristic 1b76649c-7f70-4679-9b31-87e2f5f41725, minimum mV
+ * seen during the last burst, uint16 little-endian
+ */
+#define BLE_SVC_BATTERY_CHR_LOADED_MV_UUID128                               \
+    0x25, 0x17, 0xf4, 0xf5, 0xe2, 0x87, 0x31, 0x9b,                         \
+    0x79, 0x46, 0x70, 0x7f, 0x9c, 0x64, 0x76, 0x1b
+
+extern const ble_uuid16_t ble_svc_battery_uuid;
+extern const struct ble_gatt_chr_def ble_svc_battery_chrs[];
+
+/* Service definition, for composing into a larger const service table */
+#define BLE_SVC_BATTERY_SVC_DEF {                                       \
+    .type = BLE_GATT_SVC_TYPE_PRIMARY,                                  \
+    .uuid = &ble_svc_battery_uuid.u,                                    \
+    .characteristics = ble_svc_battery_chrs,                            \
+}
 
 void
 ble_svc_battery_init(void);
 
+int
+ble_svc_battery_start(void);
+
+int
+ble_svc_battery_burst(void);
+
+uint16_t
+ble_svc_battery_loaded_mv(void);
+
 #ifdef __cplusplus
 }
 #endif
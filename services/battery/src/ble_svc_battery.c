@@ -27,6 +27,9 @@
 #include "host/ble_hs.h"
 #include "host/ble_uuid.h"
 #include "os/os_dev.h"
+#include "os/os_cputime.h"
+#include "os/endian.h"
+#include "stats/stats.h"
 #include "battery/ble_svc_battery.h"
 #include <adc/adc.h>
 
@@ -35,51 +38,111 @@
 /* ADC */
 #include "adc/adc.h"
 
-// /* ADC Task settings */
-#define ADC_STACK_SIZE          (OS_STACK_ALIGN(32))
+// /* ADC Task settings, the task also does the adc setup */
+#define ADC_STACK_SIZE          (OS_STACK_ALIGN(128))
 struct os_task ble_svc_battery_adc_task;
 static bssnz_t os_stack_t ble_svc_battery_adc_stack[ADC_STACK_SIZE];
 
+/* Lets the task look up the adc, see ble_svc_battery_start */
+static struct os_sem ble_svc_battery_start_sem;
+static bool ble_svc_battery_start_requested;
+
+/* When our sysinit began, so ready_us is time since then */
+static uint32_t ble_svc_battery_init_start;
+
 static struct adc_dev *ble_svc_battery_adc;
 
 static uint16_t ble_svc_battery_value;
 
+/* Burst sampling under load, conversions left to start, burst conversions
+ * started but not yet read, and lowest mV seen
+ */
+static struct os_callout ble_svc_battery_burst_callout;
+static volatile int ble_svc_battery_burst_remaining;
+static volatile int ble_svc_battery_burst_pending;
+static volatile bool ble_svc_battery_burst_active;
+static volatile uint16_t ble_svc_battery_burst_min_mv;
+static uint16_t ble_svc_battery_loaded_value;
+
 /* battery attr read handle */
 static uint16_t battery_attr_read_handle;
+static uint16_t battery_loaded_mv_read_handle;
+
+/* Boot timing, usecs */
+STATS_SECT_START(battery_boot_stats)
+STATS_SECT_ENTRY(sysinit_us)
+STATS_SECT_ENTRY(deferred_us)
+STATS_SECT_ENTRY(ready_us)
+STATS_SECT_END
+
+static STATS_SECT_DECL(battery_boot_stats) g_stats_battery_boot;
+
+static STATS_NAME_START(battery_boot_stats)
+STATS_NAME(battery_boot_stats, sysinit_us)
+STATS_NAME(battery_boot_stats, deferred_us)
+STATS_NAME(battery_boot_stats, ready_us)
+STATS_NAME_END(battery_boot_stats)
 
 
 static int
 gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                               struct ble_gatt_access_ctxt *ctxt, void *arg);
 
-static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
+const ble_uuid16_t ble_svc_battery_uuid =
+    BLE_UUID16_INIT(BLE_SVC_BATTERY_UUID16);
+
+static const ble_uuid16_t ble_svc_battery_chr_level_uuid =
+    BLE_UUID16_INIT(BLE_SVC_BATTERY_CHR_LEVEL_UUID16);
+
+static const ble_uuid128_t ble_svc_battery_chr_loaded_mv_uuid =
+    BLE_UUID128_INIT(BLE_SVC_BATTERY_CHR_LOADED_MV_UUID128);
+
+const struct ble_gatt_chr_def ble_svc_battery_chrs[] = {
     {
-        /* Service: Battery */
-        .type = BLE_GATT_SVC_TYPE_PRIMARY,
-        .uuid = BLE_UUID16_DECLARE(BLE_SVC_BATTERY_UUID16),
-        .characteristics = (struct ble_gatt_chr_def[]) { {
-            .uuid = BLE_UUID16_DECLARE(BLE_SVC_BATTERY_CHR_LEVEL_UUID16),
-            .val_handle = &battery_attr_read_handle,
-            .access_cb = gatt_svr_chr_access,
-            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
-        }, {
-            0, /* No more characteristics in this service */
-        } },
+        .uuid = &ble_svc_battery_chr_level_uuid.u,
+        .val_handle = &battery_attr_read_handle,
+        .access_cb = gatt_svr_chr_access,
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+    }, {
+        .uuid = &ble_svc_battery_chr_loaded_mv_uuid.u,
+        .val_handle = &battery_loaded_mv_read_handle,
+        .access_cb = gatt_svr_chr_access,
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+    }, {
+        0, /* No more characteristics in this service */
     },
+};
+
+#if MYNEWT_VAL(BATTERY_GATT_REGISTER)
+static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
+    /* Service: Battery */
+    BLE_SVC_BATTERY_SVC_DEF,
     {
         0, /* No more services */
     },
 };
+#endif
 
 static int
 gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                                struct ble_gatt_access_ctxt *ctxt, void *arg)
 {
+    uint8_t buf[2];
     int rc;
 
+    /* A read counts as first use, no value until the adc is up though */
+    if (ble_svc_battery_adc == NULL) {
+        ble_svc_battery_start();
+    }
+
     switch (ctxt->op) {
         case BLE_GATT_ACCESS_OP_READ_CHR:
             assert(ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR);
+            if (attr_handle == battery_loaded_mv_read_handle) {
+                put_le16(buf, ble_svc_battery_loaded_value);
+                rc = os_mbuf_append(ctxt->om, buf, sizeof buf);
+                return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+            }
             rc = os_mbuf_append(ctxt->om, &ble_svc_battery_value,
                                 sizeof ble_svc_battery_value);
             return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
@@ -89,6 +152,7 @@ gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
     }
 }
 
+#if MYNEWT_VAL(BATTERY_GATT_REGISTER)
 /**
  * Battery GATT server initialization
  *
@@ -113,6 +177,7 @@ battery_gatt_svr_init(void)
 err:
     return rc;
 }
+#endif
 
 //stolen from nordic app_util.h
 static __INLINE uint8_t battery_level_in_percent(const uint16_t mvolts)
@@ -172,25 +237,209 @@ int
 ble_svc_battery_adc_read_event(struct adc_dev *dev, void *arg, uint8_t etype,
         void *buffer, int buffer_len)
 {
-    int value = ble_svc_battery_adc_read(buffer, buffer_len);
+    int value;
+
+    if (etype != ADC_EVENT_RESULT) {
+        return (0);
+    }
+
+    value = ble_svc_battery_adc_read(buffer, buffer_len);
+
+    /* Results for burst conversions only feed the minimum, not the level */
+    if (ble_svc_battery_burst_pending > 0) {
+        ble_svc_battery_burst_pending--;
+        if (value > 0 && value < ble_svc_battery_burst_min_mv) {
+            ble_svc_battery_burst_min_mv = value;
+        }
+        return (0);
+    }
+
     ble_svc_battery_value = battery_level_in_percent(value);
     return (0);
 } 
 
+static void
+ble_svc_battery_burst_cb(struct os_event *ev)
+{
+    uint16_t min_mv;
+    os_sr_t sr;
+
+    if (ble_svc_battery_burst_remaining > 0) {
+        ble_svc_battery_burst_remaining--;
+
+        /* Tag the conversion before starting it, its result can come in
+         * before adc_sample returns
+         */
+        OS_ENTER_CRITICAL(sr);
+        ble_svc_battery_burst_pending++;
+        OS_EXIT_CRITICAL(sr);
+
+        if (adc_sample(ble_svc_battery_adc) != 0) {
+            OS_ENTER_CRITICAL(sr);
+            if (ble_svc_battery_burst_pending > 0) {
+                ble_svc_battery_burst_pending--;
+            }
+            OS_EXIT_CRITICAL(sr);
+        }
+
+        os_callout_reset(&ble_svc_battery_burst_callout,
+            (MYNEWT_VAL(BATTERY_BURST_INTERVAL) * OS_TICKS_PER_SEC) / 1000);
+        return;
+    }
+
+    /* Last conversion has had an interval to complete, publish. Anything
+     * still tagged never completed, drop it so later results count toward
+     * the level again.
+     */
+    OS_ENTER_CRITICAL(sr);
+    min_mv = ble_svc_battery_burst_min_mv;
+    ble_svc_battery_burst_pending = 0;
+    ble_svc_battery_burst_active = false;
+    OS_EXIT_CRITICAL(sr);
+
+    if (min_mv != UINT16_MAX) {
+        ble_svc_battery_loaded_value = min_mv;
+        ble_gatts_chr_updated(battery_loaded_mv_read_handle);
+    }
+}
+
+/**
+ * Samples the battery BATTERY_BURST_SAMPLES times, BATTERY_BURST_INTERVAL ms
+ * apart, and reports the minimum as the loaded voltage. Meant to be called
+ * right after queueing radio activity, ie a button press notification, so
+ * the burst overlaps its transmission. A call while a burst is running is
+ * absorbed by it.
+ *
+ * @return 0 on success; OS_ENOENT if the adc isn't ready yet, it is started
+ *         for next time
+ */
+int
+ble_svc_battery_burst(void)
+{
+    os_sr_t sr;
+
+    if (ble_svc_battery_adc == NULL) {
+        ble_svc_battery_start();
+        return OS_ENOENT;
+    }
+
+    OS_ENTER_CRITICAL(sr);
+    if (ble_svc_battery_burst_active) {
+        OS_EXIT_CRITICAL(sr);
+        return 0;
+    }
+    ble_svc_battery_burst_active = true;
+    ble_svc_battery_burst_min_mv = UINT16_MAX;
+    ble_svc_battery_burst_remaining = MYNEWT_VAL(BATTERY_BURST_SAMPLES);
+    OS_EXIT_CRITICAL(sr);
+
+    os_callout_reset(&ble_svc_battery_burst_callout, 0);
+    return 0;
+}
+
+/**
+ * Minimum mV seen during the last completed burst, 0 if none has run
+ */
+uint16_t
+ble_svc_battery_loaded_mv(void)
+{
+    return ble_svc_battery_loaded_value;
+}
+
+/**
+ * Adc setup and first sample, done by the task instead of sysinit. A
+ * missing BATTERY_ADC_NAME device still panics.
+ */
+static void
+ble_svc_battery_deferred_init(void)
+{
+    uint32_t start;
+    int rc;
+
+    start = os_cputime_get32();
+
+    os_callout_init(&ble_svc_battery_burst_callout, os_eventq_dflt_get(),
+                    ble_svc_battery_burst_cb, NULL);
+
+    ble_svc_battery_adc = (struct adc_dev *)os_dev_lookup(MYNEWT_VAL(BATTERY_ADC_NAME));
+    SYSINIT_PANIC_ASSERT(ble_svc_battery_adc != NULL);
+
+    rc = adc_event_handler_set(ble_svc_battery_adc, ble_svc_battery_adc_read_event, (void *) NULL);
+    SYSINIT_PANIC_ASSERT(rc == 0);
+
+    // Kick off a sample
+    rc = adc_sample(ble_svc_battery_adc);
+    SYSINIT_PANIC_ASSERT(rc == 0);
+
+    g_stats_battery_boot.sdeferred_us =
+        os_cputime_ticks_to_usecs(os_cputime_get32() - start);
+    g_stats_battery_boot.sready_us =
+        os_cputime_ticks_to_usecs(os_cputime_get32() -
+                                  ble_svc_battery_init_start);
+}
+
 static void
 ble_svc_battery_adc_task_handler(void *unused)
 {
+    int i;
+
+#if MYNEWT_VAL(BATTERY_START_ON_SYNC)
+    /* Host sync, a read, a burst or ble_svc_battery_start, whichever is
+     * first. Sync is polled once a tick.
+     */
+    while (!ble_hs_synced()) {
+        if (os_sem_pend(&ble_svc_battery_start_sem, 1) == OS_OK) {
+            break;
+        }
+    }
+#else
+    os_sem_pend(&ble_svc_battery_start_sem, OS_WAIT_FOREVER);
+#endif
+
+    ble_svc_battery_deferred_init();
+
     while (1) {
-        adc_sample(ble_svc_battery_adc);
         /* Wait 30 min */
         os_time_delay(OS_TICKS_PER_SEC * MYNEWT_VAL(BATTERY_SAMPLE_DELAY));
+
+        /* The adc may be busy with a burst, retry until it has finished */
+        for (i = 0; i <= MYNEWT_VAL(BATTERY_BURST_SAMPLES); i++) {
+            if (adc_sample(ble_svc_battery_adc) == 0) {
+                break;
+            }
+            os_time_delay((MYNEWT_VAL(BATTERY_BURST_INTERVAL) * OS_TICKS_PER_SEC) / 1000);
+        }
+    }
+}
+
+/**
+ * Starts sampling now instead of waiting for host sync or first use. With
+ * BATTERY_START_ON_SYNC off, call it once advertising is up.
+ *
+ * @return 0 on success; non-zero on failure
+ */
+int
+ble_svc_battery_start(void)
+{
+    os_sr_t sr;
+    bool requested;
+
+    OS_ENTER_CRITICAL(sr);
+    requested = ble_svc_battery_start_requested;
+    ble_svc_battery_start_requested = true;
+    OS_EXIT_CRITICAL(sr);
+
+    if (requested) {
+        return 0;
     }
+    return os_sem_release(&ble_svc_battery_start_sem);
 }
 
 /**
  * Battery service initialization
  *
- * @param Maximum input
+ * Only registers GATT and creates the task, the adc is looked up and first
+ * sampled from the task on host sync or first use.
  */
 void
 ble_svc_battery_init(void)
@@ -200,20 +449,24 @@ ble_svc_battery_init(void)
     /* Ensure this function only gets called by sysinit. */
     SYSINIT_ASSERT_ACTIVE();
 
-    /* Automatically register the service. */
-    rc = battery_gatt_svr_init();
+    ble_svc_battery_init_start = os_cputime_get32();
+
+    rc = stats_init(STATS_HDR(g_stats_battery_boot),
+                    STATS_SIZE_INIT_PARMS(g_stats_battery_boot, STATS_SIZE_32),
+                    STATS_NAME_INIT_PARMS(battery_boot_stats));
     SYSINIT_PANIC_ASSERT(rc == 0);
 
-    /* ADC init */
-    ble_svc_battery_adc = (struct adc_dev *)os_dev_lookup(MYNEWT_VAL(BATTERY_ADC_NAME));
-    SYSINIT_PANIC_ASSERT(ble_svc_battery_adc != NULL);
+    rc = stats_register("battery_boot", STATS_HDR(g_stats_battery_boot));
+    SYSINIT_PANIC_ASSERT(rc == 0);
 
-    rc = adc_event_handler_set(ble_svc_battery_adc, ble_svc_battery_adc_read_event, (void *) NULL);
+    rc = os_sem_init(&ble_svc_battery_start_sem, 0);
     SYSINIT_PANIC_ASSERT(rc == 0);
 
-    // Kick off a sample
-    rc = adc_sample(ble_svc_battery_adc);
+#if MYNEWT_VAL(BATTERY_GATT_REGISTER)
+    /* Automatically register the service. */
+    rc = battery_gatt_svr_init();
     SYSINIT_PANIC_ASSERT(rc == 0);
+#endif
 
     /* Create the battery_read reader task.
      * All sensor operations are performed in this task.
@@ -222,4 +475,8 @@ ble_svc_battery_init(void)
         NULL, MYNEWT_VAL(BATTERY_TASK_PRIO), OS_WAIT_FOREVER,
         ble_svc_battery_adc_stack, ADC_STACK_SIZE);
     SYSINIT_PANIC_ASSERT(rc == 0);
+
+    g_stats_battery_boot.ssysinit_us =
+        os_cputime_ticks_to_usecs(os_cputime_get32() -
+                                  ble_svc_battery_init_start);
 }
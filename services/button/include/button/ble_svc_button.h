@@ -20,6 +20,8 @@
 #ifndef H_BLE_SVC_BUTTON_
 #define H_BLE_SVC_BUTTON_
 
+#include "host/ble_gatt.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -30,8 +32,35 @@ extern "C" {
 /* 16 Bit Alert Notification Servivce Characteristic UUIDs */
 #define BLE_SVC_BUTTON_CHR_UUID16_BUTTON_STAT                  0xAA01
 
+/*
+ * Button state record, version 1, little-endian, packed (11 bytes):
+ *  0  uint8   version
+ *  1  uint32  press count
+ *  5  uint8   current state, 1 when pressed
+ *  6  uint8   last gesture
+ *  7  uint32  ms since the last gesture, or since boot if none
+ */
+#define BLE_SVC_BUTTON_STATE_VERSION                           1
+#define BLE_SVC_BUTTON_STATE_LEN                               11
+
+#define BLE_SVC_BUTTON_GESTURE_NONE                            0
+#define BLE_SVC_BUTTON_GESTURE_PRESS                           1
+#define BLE_SVC_BUTTON_GESTURE_RELEASE                         2
+
+extern const ble_uuid16_t ble_svc_button_uuid;
+extern const struct ble_gatt_chr_def ble_svc_button_chrs[];
+
+/* Service definition, for composing into a larger const service table */
+#define BLE_SVC_BUTTON_SVC_DEF {                                      \
+    .type = BLE_GATT_SVC_TYPE_PRIMARY,                                 \
+    .uuid = &ble_svc_button_uuid.u,                                    \
+    .characteristics = ble_svc_button_chrs,                            \
+}
+
 void ble_svc_button_init(void);
 
+int ble_svc_button_start(void);
+
 void ble_svc_button_register_handler(os_event_fn);
 
 uint32_t ble_svc_button_count(void);
@@ -23,9 +23,14 @@
 #include "stats/stats.h"
 #include "bsp/bsp.h"
 #include "os/os.h"
+#include "os/os_cputime.h"
+#include "os/endian.h"
 #include "hal/hal_gpio.h"
 #include "host/ble_hs.h"
 #include "button/ble_svc_button.h"
+#if MYNEWT_VAL(BUTTON_BATTERY_BURST)
+#include "battery/ble_svc_battery.h"
+#endif
 
 static struct os_event advertise_handle_event;
 
@@ -43,18 +48,104 @@ static STATS_NAME_START(gpio_stats)
 STATS_NAME(gpio_stats, toggles)
 STATS_NAME_END(gpio_stats)
 
-// /* Button Task settings */
-#define BUTTON_STACK_SIZE          (OS_STACK_ALIGN(48))
+//how long it took to get the button going, in usecs
+STATS_SECT_START(button_boot_stats)
+STATS_SECT_ENTRY(sysinit_us)
+STATS_SECT_ENTRY(deferred_us)
+STATS_SECT_ENTRY(ready_us)
+STATS_SECT_END
+
+static STATS_SECT_DECL(button_boot_stats) g_stats_button_boot;
+
+static STATS_NAME_START(button_boot_stats)
+STATS_NAME(button_boot_stats, sysinit_us)
+STATS_NAME(button_boot_stats, deferred_us)
+STATS_NAME(button_boot_stats, ready_us)
+STATS_NAME_END(button_boot_stats)
+
+// /* Button Task settings, sized for the deferred init as well as the loop */
+#define BUTTON_STACK_SIZE          (OS_STACK_ALIGN(128))
 struct os_task button_task;
 static bssnz_t os_stack_t button_stack[BUTTON_STACK_SIZE];
 
+/* Released by ble_svc_button_start */
+static struct os_sem button_start_sem;
+
+/* cputime at the start of our sysinit, ready_us counts from here */
+static uint32_t button_init_start;
+
 static int last;
 static bool pressed;
+static uint8_t last_gesture = BLE_SVC_BUTTON_GESTURE_NONE;
+static os_time_t last_gesture_time;
+
+/**
+ * Updates the state, count and gesture together so a read never sees half
+ * of a gesture, then notifies.
+ */
+static void
+ble_svc_button_gesture(uint8_t gesture)
+{
+    os_sr_t sr;
+
+    OS_ENTER_CRITICAL(sr);
+    pressed = gesture == BLE_SVC_BUTTON_GESTURE_PRESS;
+    if (pressed) {
+        STATS_INC(g_stats_gpio_toggle, toggles);
+    }
+    last_gesture = gesture;
+    last_gesture_time = os_time_get();
+    OS_EXIT_CRITICAL(sr);
+
+    ble_gatts_chr_updated(ble_svc_button_button_value_handle);
+}
+
+/**
+ * Gpio and stats setup, left out of sysinit. A bad pin is still a boot
+ * failure.
+ */
+static void
+ble_svc_button_deferred_init(void)
+{
+    uint32_t start;
+    int rc;
+
+    start = os_cputime_get32();
+
+    rc = hal_gpio_init_in(MYNEWT_VAL(BUTTON_PIN), MYNEWT_VAL(BUTTON_PULLUP));
+    SYSINIT_PANIC_ASSERT(rc == 0);
+
+    rc = stats_init(STATS_HDR(g_stats_gpio_toggle),
+                    STATS_SIZE_INIT_PARMS(g_stats_gpio_toggle, STATS_SIZE_32),
+                    STATS_NAME_INIT_PARMS(gpio_stats));
+    SYSINIT_PANIC_ASSERT(rc == 0);
+
+    rc = stats_register("gpio_toggle", STATS_HDR(g_stats_gpio_toggle));
+    SYSINIT_PANIC_ASSERT(rc == 0);
+
+    g_stats_button_boot.sdeferred_us =
+        os_cputime_ticks_to_usecs(os_cputime_get32() - start);
+    g_stats_button_boot.sready_us =
+        os_cputime_ticks_to_usecs(os_cputime_get32() - button_init_start);
+}
 
 //implementing button on 2 consecutive low reads
 static void
 button_task_handler(void *unused)
 {
+#if MYNEWT_VAL(BUTTON_START_ON_SYNC)
+    //check for sync every tick, unless someone starts us first
+    while (!ble_hs_synced()) {
+        if (os_sem_pend(&button_start_sem, 1) == OS_OK) {
+            break;
+        }
+    }
+#else
+    os_sem_pend(&button_start_sem, OS_WAIT_FOREVER);
+#endif
+
+    ble_svc_button_deferred_init();
+
     while (1) {
         int current = hal_gpio_read(MYNEWT_VAL(BUTTON_PIN));
 
@@ -66,9 +157,12 @@ button_task_handler(void *unused)
 
         if( !pressed && current && last )
         {
-            pressed = true;
-            STATS_INC(g_stats_gpio_toggle, toggles);
-            ble_gatts_chr_updated(ble_svc_button_button_value_handle);
+            ble_svc_button_gesture(BLE_SVC_BUTTON_GESTURE_PRESS);
+
+#if MYNEWT_VAL(BUTTON_BATTERY_BURST)
+            //sample the battery while the notification loads the radio
+            ble_svc_battery_burst();
+#endif
 
             //keep stack small, trigger callback on the default queue
             if (advertise_handle_event.ev_cb)
@@ -79,7 +173,7 @@ button_task_handler(void *unused)
 
         }else if(pressed && last != current)
         {
-            pressed = false;
+            ble_svc_button_gesture(BLE_SVC_BUTTON_GESTURE_RELEASE);
         }
         last = current;
 
@@ -93,25 +187,71 @@ static int
 ble_svc_button_access(uint16_t conn_handle, uint16_t attr_handle,
                    struct ble_gatt_access_ctxt *ctxt, void *arg);
 
-static const struct ble_gatt_svc_def ble_svc_button_defs[] = {
+const ble_uuid16_t ble_svc_button_uuid =
+    BLE_UUID16_INIT(BLE_SVC_BUTTON_UUID16);
+
+static const ble_uuid16_t ble_svc_button_chr_button_stat_uuid =
+    BLE_UUID16_INIT(BLE_SVC_BUTTON_CHR_UUID16_BUTTON_STAT);
+
+const struct ble_gatt_chr_def ble_svc_button_chrs[] = {
     {
-        /*** Alert Notification Service. */
-        .type = BLE_GATT_SVC_TYPE_PRIMARY,
-        .uuid = BLE_UUID16_DECLARE(BLE_SVC_BUTTON_UUID16),
-        .characteristics = (struct ble_gatt_chr_def[]) { {
-            .uuid = BLE_UUID16_DECLARE(BLE_SVC_BUTTON_CHR_UUID16_BUTTON_STAT),
-            .access_cb = ble_svc_button_access,
-            .val_handle = &ble_svc_button_button_value_handle,
-            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
-        }, {
-            0, /* No more characteristics in this service. */
-        } },
+        .uuid = &ble_svc_button_chr_button_stat_uuid.u,
+        .access_cb = ble_svc_button_access,
+        .val_handle = &ble_svc_button_button_value_handle,
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+    }, {
+        0, /* No more characteristics in this service. */
     },
+};
+
+#if MYNEWT_VAL(BUTTON_GATT_REGISTER)
+static const struct ble_gatt_svc_def ble_svc_button_defs[] = {
+    /*** Alert Notification Service. */
+    BLE_SVC_BUTTON_SVC_DEF,
 
     {
         0, /* No more services. */
     },
 };
+#endif
+
+/**
+ * Encodes the button state record straight into the mbuf, serves both reads
+ * and the notifications sent through ble_gatts_chr_updated.
+ *
+ * @return 0 on success; BLE_HS_ENOMEM if the mbuf can't be extended
+ */
+static int
+ble_svc_button_state_encode(struct os_mbuf *om)
+{
+    uint32_t count;
+    bool state;
+    uint8_t gesture;
+    os_time_t gesture_time;
+    os_sr_t sr;
+    uint8_t *buf;
+
+    buf = os_mbuf_extend(om, BLE_SVC_BUTTON_STATE_LEN);
+    if (buf == NULL) {
+        return BLE_HS_ENOMEM;
+    }
+
+    /* Snapshot, the button task can preempt us mid gesture */
+    OS_ENTER_CRITICAL(sr);
+    count = g_stats_gpio_toggle.stoggles;
+    state = pressed;
+    gesture = last_gesture;
+    gesture_time = last_gesture_time;
+    OS_EXIT_CRITICAL(sr);
+
+    buf[0] = BLE_SVC_BUTTON_STATE_VERSION;
+    put_le32(buf + 1, count);
+    buf[5] = state;
+    buf[6] = gesture;
+    put_le32(buf + 7, os_time_ticks_to_ms32(os_time_get() - gesture_time));
+
+    return 0;
+}
 
 /**
  * Button access function
@@ -133,8 +273,7 @@ ble_svc_button_access(uint16_t conn_handle, uint16_t attr_handle,
 
     case BLE_SVC_BUTTON_CHR_UUID16_BUTTON_STAT:
         if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-            rc = os_mbuf_append(ctxt->om, &g_stats_gpio_toggle.stoggles,
-                                sizeof g_stats_gpio_toggle.stoggles);
+            rc = ble_svc_button_state_encode(ctxt->om);
             return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
         }else{
             assert(0);
@@ -149,6 +288,18 @@ ble_svc_button_access(uint16_t conn_handle, uint16_t attr_handle,
 }
 
 
+/**
+ * Lets the button task set up the gpio and start polling, needed with
+ * BUTTON_START_ON_SYNC off.
+ *
+ * @return 0 on success; non-zero on failure
+ */
+int
+ble_svc_button_start(void)
+{
+    return os_sem_release(&button_start_sem);
+}
+
 void ble_svc_button_register_handler(os_event_fn *cb)
 {
     advertise_handle_event.ev_cb = cb;
@@ -160,29 +311,40 @@ ble_svc_button_count(void)
     return g_stats_gpio_toggle.stoggles;
 }
 
+/**
+ * Button service initialization
+ *
+ * Only registers GATT and creates the task, the task sets up the gpio once
+ * the host syncs or ble_svc_button_start is called.
+ */
 void
 ble_svc_button_init(void)
 {
     int rc;
 
-    hal_gpio_init_in(MYNEWT_VAL(BUTTON_PIN), MYNEWT_VAL(BUTTON_PULLUP));
+    /* Ensure this function only gets called by sysinit. */
+    SYSINIT_ASSERT_ACTIVE();
 
-    stats_init(STATS_HDR(g_stats_gpio_toggle),
-               STATS_SIZE_INIT_PARMS(g_stats_gpio_toggle, STATS_SIZE_32),
-               STATS_NAME_INIT_PARMS(gpio_stats));
+    button_init_start = os_cputime_get32();
 
-    stats_register("gpio_toggle", STATS_HDR(g_stats_gpio_toggle));
+    rc = stats_init(STATS_HDR(g_stats_button_boot),
+                    STATS_SIZE_INIT_PARMS(g_stats_button_boot, STATS_SIZE_32),
+                    STATS_NAME_INIT_PARMS(button_boot_stats));
+    SYSINIT_PANIC_ASSERT(rc == 0);
 
-    ble_gatts_chr_updated(ble_svc_button_button_value_handle);
+    rc = stats_register("button_boot", STATS_HDR(g_stats_button_boot));
+    SYSINIT_PANIC_ASSERT(rc == 0);
 
-    /* Ensure this function only gets called by sysinit. */
-    SYSINIT_ASSERT_ACTIVE();
+    rc = os_sem_init(&button_start_sem, 0);
+    SYSINIT_PANIC_ASSERT(rc == 0);
 
+#if MYNEWT_VAL(BUTTON_GATT_REGISTER)
     rc = ble_gatts_count_cfg(ble_svc_button_defs);
     SYSINIT_PANIC_ASSERT(rc == 0);
 
     rc = ble_gatts_add_svcs(ble_svc_button_defs);
     SYSINIT_PANIC_ASSERT(rc == 0);
+#endif
 
     /* Create the button reader task.
      * All sensor operations are performed in this task.
@@ -191,4 +353,7 @@ ble_svc_button_init(void)
             NULL, MYNEWT_VAL(BUTTON_TASK_PRIO), OS_WAIT_FOREVER,
             button_stack, BUTTON_STACK_SIZE);
     SYSINIT_PANIC_ASSERT(rc == 0);
+
+    g_stats_button_boot.ssysinit_us =
+        os_cputime_ticks_to_usecs(os_cputime_get32() - button_init_start);
 }
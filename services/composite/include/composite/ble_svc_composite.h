@@ -0,0 +1,46 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _BLE_SVC_COMPOSITE_H_
+#define _BLE_SVC_COMPOSITE_H_
+
+#include "syscfg/syscfg.h"
+
+#if MYNEWT_VAL(COMPOSITE_BUTTON)
+#include "button/ble_svc_button.h"
+#endif
+#if MYNEWT_VAL(COMPOSITE_BATTERY)
+#include "battery/ble_svc_battery.h"
+#endif
+#if MYNEWT_VAL(COMPOSITE_DIS)
+#include "dis/ble_svc_dis.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void
+ble_svc_composite_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BLE_SVC_COMPOSITE_H_ */
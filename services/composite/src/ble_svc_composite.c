@@ -0,0 +1,114 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <assert.h>
+
+#include "sysinit/sysinit.h"
+#include "os/os_cputime.h"
+#include "stats/stats.h"
+#include "host/ble_hs.h"
+#include "composite/ble_svc_composite.h"
+
+#define BLE_SVC_COMPOSITE_ANY                                           \
+    (MYNEWT_VAL(COMPOSITE_BUTTON) || MYNEWT_VAL(COMPOSITE_BATTERY) ||   \
+     MYNEWT_VAL(COMPOSITE_DIS))
+
+//boot timing in usecs, counting and registering the combined table
+STATS_SECT_START(composite_boot_stats)
+STATS_SECT_ENTRY(sysinit_us)
+STATS_SECT_END
+
+static STATS_SECT_DECL(composite_boot_stats) g_stats_composite_boot;
+
+static STATS_NAME_START(composite_boot_stats)
+STATS_NAME(composite_boot_stats, sysinit_us)
+STATS_NAME_END(composite_boot_stats)
+
+#if BLE_SVC_COMPOSITE_ANY
+/* Every selected service in one table, so it lives in flash and the host
+ * counts and registers it in a single pass.
+ */
+static const struct ble_gatt_svc_def ble_svc_composite_defs[] = {
+#if MYNEWT_VAL(COMPOSITE_BUTTON)
+    BLE_SVC_BUTTON_SVC_DEF,
+#endif
+#if MYNEWT_VAL(COMPOSITE_BATTERY)
+    BLE_SVC_BATTERY_SVC_DEF,
+#endif
+#if MYNEWT_VAL(COMPOSITE_DIS)
+    BLE_SVC_DIS_SVC_DEF,
+#endif
+    {
+        0, /* No more services */
+    },
+};
+#endif
+
+/**
+ * Combined GATT server initialization
+ *
+ * @return 0 on success; non-zero on failure
+ */
+static int
+composite_gatt_svr_init(void)
+{
+#if BLE_SVC_COMPOSITE_ANY
+    int rc;
+
+    /* Sizes the host's attribute pools for exactly the combined table. */
+    rc = ble_gatts_count_cfg(ble_svc_composite_defs);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return ble_gatts_add_svcs(ble_svc_composite_defs);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Combined service initialization
+ */
+void
+ble_svc_composite_init(void)
+{
+    uint32_t start;
+    int rc;
+
+    /* Ensure this function only gets called by sysinit. */
+    SYSINIT_ASSERT_ACTIVE();
+
+    rc = stats_init(STATS_HDR(g_stats_composite_boot),
+                    STATS_SIZE_INIT_PARMS(g_stats_composite_boot,
+                                          STATS_SIZE_32),
+                    STATS_NAME_INIT_PARMS(composite_boot_stats));
+    SYSINIT_PANIC_ASSERT(rc == 0);
+
+    start = os_cputime_get32();
+
+    rc = composite_gatt_svr_init();
+    SYSINIT_PANIC_ASSERT(rc == 0);
+
+    g_stats_composite_boot.ssysinit_us =
+        os_cputime_ticks_to_usecs(os_cputime_get32() - start);
+
+    rc = stats_register("composite_boot", STATS_HDR(g_stats_composite_boot));
+    SYSINIT_PANIC_ASSERT(rc == 0);
+}
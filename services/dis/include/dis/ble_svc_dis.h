@@ -20,6 +20,8 @@
 #ifndef _BLEDIS_H_
 #define _BLEDIS_H_
 
+#include "host/ble_gatt.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,6 +35,16 @@ extern "C" {
 #define BLE_SVC_DIS_CHR_SW_REV_UUID16                       0x2A28
 #define BLE_SVC_DIS_CHR_MFG_NAME_UUID16                     0x2A29
 
+extern const ble_uuid16_t ble_svc_dis_uuid;
+extern const struct ble_gatt_chr_def ble_svc_dis_chrs[];
+
+/* Service definition, for composing into a larger const service table */
+#define BLE_SVC_DIS_SVC_DEF {                                           \
+    .type = BLE_GATT_SVC_TYPE_PRIMARY,                                  \
+    .uuid = &ble_svc_dis_uuid.u,                                        \
+    .characteristics = ble_svc_dis_chrs,                                \
+}
+
 void
 ble_svc_dis_init(void);
 
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "syscfg/syscfg.h"
 #include "sysinit/sysinit.h"
 #include "host/ble_hs.h"
 #include "host/ble_uuid.h"
@@ -32,55 +33,109 @@ gatt_svr_chr_access_dis(uint16_t conn_handle, uint16_t attr_handle,
                               struct ble_gatt_access_ctxt *ctxt, void *arg);
 
 
-static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
+const ble_uuid16_t ble_svc_dis_uuid = BLE_UUID16_INIT(BLE_SVC_DIS_UUID16);
+
+#if MYNEWT_VAL(DIS_SYS_ID)
+static const ble_uuid16_t ble_svc_dis_chr_sys_id_uuid =
+    BLE_UUID16_INIT(BLE_SVC_DIS_CHR_SYS_ID_UUID16);
+#endif
+#if MYNEWT_VAL(DIS_MODEL_NUM)
+static const ble_uuid16_t ble_svc_dis_chr_model_num_uuid =
+    BLE_UUID16_INIT(BLE_SVC_DIS_CHR_MODEL_NUM_UUID16);
+#endif
+#if MYNEWT_VAL(DIS_SERIAL_NUM)
+static const ble_uuid16_t ble_svc_dis_chr_serial_num_uuid =
+    BLE_UUID16_INIT(BLE_SVC_DIS_CHR_SERIAL_NUM_UUID16);
+#endif
+#if MYNEWT_VAL(DIS_FW_REV)
+static const ble_uuid16_t ble_svc_dis_chr_fw_rev_uuid =
+    BLE_UUID16_INIT(BLE_SVC_DIS_CHR_FW_REV_UUID16);
+#endif
+#if MYNEWT_VAL(DIS_HW_REV)
+static const ble_uuid16_t ble_svc_dis_chr_hw_rev_uuid =
+    BLE_UUID16_INIT(BLE_SVC_DIS_CHR_HW_REV_UUID16);
+#endif
+#if MYNEWT_VAL(DIS_SW_REV)
+static const ble_uuid16_t ble_svc_dis_chr_sw_rev_uuid =
+    BLE_UUID16_INIT(BLE_SVC_DIS_CHR_SW_REV_UUID16);
+#endif
+#if MYNEWT_VAL(DIS_MFG_NAME)
+static const ble_uuid16_t ble_svc_dis_chr_mfg_name_uuid =
+    BLE_UUID16_INIT(BLE_SVC_DIS_CHR_MFG_NAME_UUID16);
+#endif
+
+const struct ble_gatt_chr_def ble_svc_dis_chrs[] = {
+#if MYNEWT_VAL(DIS_SYS_ID)
+    {
+        /* Characteristic: Read */
+        .uuid = &ble_svc_dis_chr_sys_id_uuid.u,
+        .access_cb = gatt_svr_chr_access_dis,
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+#endif
+#if MYNEWT_VAL(DIS_MODEL_NUM)
+    {
+        /* Characteristic: Read */
+        .uuid = &ble_svc_dis_chr_model_num_uuid.u,
+        .access_cb = gatt_svr_chr_access_dis,
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+#endif
+#if MYNEWT_VAL(DIS_SERIAL_NUM)
     {
-        /* Service: dis */
-        .type = BLE_GATT_SVC_TYPE_PRIMARY,
-        .uuid = BLE_UUID16_DECLARE(BLE_SVC_DIS_UUID16),
-        .characteristics = (struct ble_gatt_chr_def[]) { {
-            /* Characteristic: Read */
-            .uuid = BLE_UUID16_DECLARE(BLE_SVC_DIS_CHR_SYS_ID_UUID16),
-            .access_cb = gatt_svr_chr_access_dis,
-            .flags = BLE_GATT_CHR_F_READ,
-        }, {
-            /* Characteristic: Read */
-            .uuid = BLE_UUID16_DECLARE(BLE_SVC_DIS_CHR_MODEL_NUM_UUID16),
-            .access_cb = gatt_svr_chr_access_dis,
-            .flags = BLE_GATT_CHR_F_READ,
-        }, {
-            /* Characteristic: Read */
-            .uuid = BLE_UUID16_DECLARE(BLE_SVC_DIS_CHR_SERIAL_NUM_UUID16),
-            .access_cb = gatt_svr_chr_access_dis,
-            .flags = BLE_GATT_CHR_F_READ,
-        }, {
-            /* Characteristic: Read */
-            .uuid = BLE_UUID16_DECLARE(BLE_SVC_DIS_CHR_FW_REV_UUID16),
-            .access_cb = gatt_svr_chr_access_dis,
-            .flags = BLE_GATT_CHR_F_READ,
-        }, {
-            /* Characteristic: Read */
-            .uuid = BLE_UUID16_DECLARE(BLE_SVC_DIS_CHR_HW_REV_UUID16),
-            .access_cb = gatt_svr_chr_access_dis,
-            .flags = BLE_GATT_CHR_F_READ,
-        }, {
-            /* Characteristic: Read */
-            .uuid = BLE_UUID16_DECLARE(BLE_SVC_DIS_CHR_SW_REV_UUID16),
-            .access_cb = gatt_svr_chr_access_dis,
-            .flags = BLE_GATT_CHR_F_READ,
-        }, {
-            /* Characteristic: Read */
-            .uuid = BLE_UUID16_DECLARE(BLE_SVC_DIS_CHR_MFG_NAME_UUID16),
-            .access_cb = gatt_svr_chr_access_dis,
-            .flags = BLE_GATT_CHR_F_READ,
-        }, {
-            0, /* No more characteristics in this service */
-        } },
+        /* Characteristic: Read */
+        .uuid = &ble_svc_dis_chr_serial_num_uuid.u,
+        .access_cb = gatt_svr_chr_access_dis,
+        .flags = BLE_GATT_CHR_F_READ,
     },
+#endif
+#if MYNEWT_VAL(DIS_FW_REV)
+    {
+        /* Characteristic: Read */
+        .uuid = &ble_svc_dis_chr_fw_rev_uuid.u,
+        .access_cb = gatt_svr_chr_access_dis,
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+#endif
+#if MYNEWT_VAL(DIS_HW_REV)
+    {
+        /* Characteristic: Read */
+        .uuid = &ble_svc_dis_chr_hw_rev_uuid.u,
+        .access_cb = gatt_svr_chr_access_dis,
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+#endif
+#if MYNEWT_VAL(DIS_SW_REV)
+    {
+        /* Characteristic: Read */
+        .uuid = &ble_svc_dis_chr_sw_rev_uuid.u,
+        .access_cb = gatt_svr_chr_access_dis,
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+#endif
+#if MYNEWT_VAL(DIS_MFG_NAME)
+    {
+        /* Characteristic: Read */
+        .uuid = &ble_svc_dis_chr_mfg_name_uuid.u,
+        .access_cb = gatt_svr_chr_access_dis,
+        .flags = BLE_GATT_CHR_F_READ,
+    },
+#endif
+    {
+        0, /* No more characteristics in this service */
+    },
+};
+
+#if MYNEWT_VAL(DIS_GATT_REGISTER)
+static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
+    /* Service: dis */
+    BLE_SVC_DIS_SVC_DEF,
 
     {
         0, /* No more services */
     },
 };
+#endif
 
 static int
 gatt_svr_chr_access_dis(uint16_t conn_handle, uint16_t attr_handle,
@@ -151,7 +206,8 @@ gatt_svr_chr_access_dis(uint16_t conn_handle, uint16_t attr_handle,
 }
 
 /**
- * dis GATT server initialization
+ * dis GATT server initialization, a no-op when the service is registered
+ * elsewhere
  *
  * @param eventq
  * @return 0 on success; non-zero on failure
@@ -159,6 +215,7 @@ gatt_svr_chr_access_dis(uint16_t conn_handle, uint16_t attr_handle,
 static int
 dis_gatt_svr_init(void)
 {
+#if MYNEWT_VAL(DIS_GATT_REGISTER)
     int rc;
 
     rc = ble_gatts_count_cfg(gatt_svr_svcs);
@@ -173,6 +230,9 @@ dis_gatt_svr_init(void)
 
 err:
     return rc;
+#else
+    return 0;
+#endif
 }
 
 /**